@@ -28,10 +28,66 @@
 #ifndef __MEMORYLT_H_INCLUDED__
 #define __MEMORYLT_H_INCLUDED__
 
+#include <cstddef>
+#include <atomic>
+#include <new>
+#include <type_traits>
+
+namespace mlt
+{
+    class ContainerStats;
+
+    /**
+    * Result of a reachability scan. Every live allocation falls in exactly one class:
+    * unreachable (nothing points to it), indirectly leaked (only other leaked blocks
+    * point to it) or still reachable (reachable from globals, the stack or other
+    * reachable blocks).*/
+    struct LeakSummary
+    {
+        int m_unreachableCount;
+        std::size_t m_unreachableBytes;
+        int m_indirectCount;
+        std::size_t m_indirectBytes;
+        int m_reachableCount;
+        std::size_t m_reachableBytes;
+    };
+
+    /** Phases of LeakTracker::Alloc/Free measured by the self profiling. */
+    enum ProfilePhase
+    {
+        ProfilePhaseAllocBlock,     ///< malloc/calloc of record + payload (+ guards)
+        ProfilePhaseAllocLink,      ///< lock wait + linking the record
+        ProfilePhaseFreeCheck,      ///< record sanity checks + guard scan
+        ProfilePhaseFreeUnlink,     ///< lock wait + unlinking the record
+        ProfilePhaseFreeRelease,    ///< free of the block
+        ProfilePhaseCount
+    };
+
+    /** Number of buckets of the profile histograms; bucket 0 counts durations in [0, 2) ticks, bucket i > 0 in [2^i, 2^(i+1)). */
+    const int kProfileHistogramBuckets = 32;
+
+    /**
+    * Self profiling data of the tracker for one thread, or for all the threads that exited
+    * (m_threadIndex == -1). Durations are in ticks: CPU cycles
+    * (rdtsc) on x86/x64, nanoseconds elsewhere.*/
+    struct TrackerProfile
+    {
+        int m_threadIndex;
+        unsigned long long m_lockAcquires;
+        /** Acquires that found m_m already locked by another thread. */
+        unsigned long long m_contendedAcquires;
+        unsigned long long m_lockWaitTicks;
+        unsigned long long m_lockHoldTicks;
+        unsigned long long m_lockWaitHistogram[kProfileHistogramBuckets];
+        unsigned long long m_lockHoldHistogram[kProfileHistogramBuckets];
+        unsigned long long m_phaseCalls[ProfilePhaseCount];
+        unsigned long long m_phaseTicks[ProfilePhaseCount];
+    };
+} //namespace mlt
+
 #if defined(_DEBUG) || defined(DEBUG)
 
 
-#include <atomic>
 #include <mutex>
 
 
@@ -63,11 +119,41 @@ void operator delete[](void* p, const char* file, int line) throw();
 
 namespace mlt
 {
-	/** Initialize the MemoryLeakTracker*/
-	void Init(bool heapCorruptionCheck = false, int buffer = 256);
+	/** Initialize the MemoryLeakTracker.
+	* When reachabilityScan is true, Close classifies the leaks using ScanForLeaks
+	* with scanThreads workers (0 means one per hardware thread), and the allocations
+	* without a site (std::allocator, ...) are recorded so the scan can use them as roots.*/
+	void Init(bool heapCorruptionCheck = false, int buffer = 256, bool reachabilityScan = false, int scanThreads = 0);
 	void Close();
 	void CheckHeapCorruption();
 
+	/**
+	* Conservative mark phase over the writable segments of every loaded module, the stacks
+	* of the live threads that went through the tracker, the untracked allocations (only
+	* recorded with Init(..., reachabilityScan = true), otherwise unreached blocks are printed
+	* as possible leaks) and the live payloads. Of each leaked cycle one block is reported as
+	* unreachable, the rest as indirectly leaked. The marking is split across workerThreads
+	* threads (0 means one per hardware thread). Reachable blocks are only counted, unless
+	* listReachable is true.
+	* The stacks of other threads are scanned whole, the part below their stack pointer
+	* included, and their registers are not seen: stale words there can make a leak look
+	* reachable, a pointer held only in a register can make a live block look leaked.*/
+	LeakSummary ScanForLeaks(bool print = true, int workerThreads = 0, bool listReachable = false);
+
+	/** Registry of the live ContainerStats, used by PrintContainerStats (and by Close).*/
+	void RegisterContainerStats(ContainerStats* stats);
+	void UnregisterContainerStats(ContainerStats* stats);
+	void PrintContainerStats();
+
+	/**
+	* Self profiling of the tracker: lock wait/hold histograms, contended acquires and ticks
+	* per phase of Alloc/Free, kept per live thread; a thread's profile is added to the "exited threads"
+	* one when it exits. Printed by Close while enabled.*/
+	void EnableProfiling(bool enabled);
+	/** Copies up to maxProfiles thread profiles into profiles; returns how many exist: one per live profiled thread, plus the exited threads one if any. */
+	int GetTrackerProfiles(TrackerProfile* profiles, int maxProfiles);
+	void PrintTrackerProfile();
+
 	class BaseLeakTracker
 	{
 	public:
@@ -86,15 +172,20 @@ namespace mlt
 
 } //namespace mlt
 
-#define	new new(__FILE__, __LINE__)
-
 #else //!_DEBUG
 
 namespace mlt
 {
-	void Init(bool heapCorruptionCheck = false, int buffer = 256){}
+	void Init(bool heapCorruptionCheck = false, int buffer = 256, bool reachabilityScan = false, int scanThreads = 0){ (void)heapCorruptionCheck; (void)buffer; (void)reachabilityScan; (void)scanThreads; }
 	void Close() {}
 	void CheckHeapCorruption() {}
+	inline LeakSummary ScanForLeaks(bool print = true, int workerThreads = 0, bool listReachable = false) { (void)print; (void)workerThreads; (void)listReachable; return LeakSummary(); }
+	inline void RegisterContainerStats(ContainerStats* stats) { (void)stats; }
+	inline void UnregisterContainerStats(ContainerStats* stats) { (void)stats; }
+	inline void PrintContainerStats() {}
+	inline void EnableProfiling(bool enabled) { (void)enabled; }
+	inline int GetTrackerProfiles(TrackerProfile* profiles, int maxProfiles) { (void)profiles; (void)maxProfiles; return 0; }
+	inline void PrintTrackerProfile() {}
 
     class BaseLeakTracker
     {
@@ -109,4 +200,216 @@ namespace mlt
 
 #endif //_DEBUG
 
+namespace mlt
+{
+    /**
+    * Allocation counters of one container instance (or of a group of containers that share it)
+    * using TrackingAllocator. The counters are atomics, so no lock is taken to update them.
+    * When arenaChunkSize is not 0 the containers get their own bump arena: memory is carved
+    * from chunks of that size, deallocate does not give it back and everything is released
+    * when the ContainerStats is destroyed. The arena is not thread safe.
+    * The ContainerStats must outlive the containers that use it.*/
+    class ContainerStats
+    {
+    public:
+        explicit ContainerStats(const char* tag, unsigned int line = 0, std::size_t arenaChunkSize = 0)
+            : m_allocations(0)
+            , m_deallocations(0)
+            , m_liveBytes(0)
+            , m_peakBytes(0)
+            , m_totalBytes(0)
+            , m_tag(tag)
+            , m_line(line)
+            , m_next(nullptr)
+            , m_prev(nullptr)
+            , m_arenaChunkSize(arenaChunkSize)
+            , m_arenaChunks(nullptr)
+            , m_arenaCursor(nullptr)
+            , m_arenaEnd(nullptr)
+        {
+            RegisterContainerStats(this);
+        }
+
+        ~ContainerStats()
+        {
+            UnregisterContainerStats(this);
+
+            while (m_arenaChunks)
+            {
+                ArenaChunk* next = m_arenaChunks->m_next;
+                FreeBlock(m_arenaChunks);
+                m_arenaChunks = next;
+            }
+        }
+
+        void* Allocate(std::size_t size, std::size_t alignment)
+        {
+            void* p = m_arenaChunkSize ? ArenaAllocate(size, alignment) : AllocBlock(size, m_tag, m_line);
+
+            m_allocations.fetch_add(1, std::memory_order_relaxed);
+            m_totalBytes.fetch_add(size, std::memory_order_relaxed);
+            std::size_t live = m_liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+            std::size_t peak = m_peakBytes.load(std::memory_order_relaxed);
+            while (peak < live && !m_peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+            {
+            }
+            return p;
+        }
+
+        void Deallocate(void* p, std::size_t size)
+        {
+            m_deallocations.fetch_add(1, std::memory_order_relaxed);
+            m_liveBytes.fetch_sub(size, std::memory_order_relaxed);
+
+            /// Arena memory is released with the arena
+            if (!m_arenaChunkSize)
+                FreeBlock(p);
+        }
+
+        /** Routes an allocation through the LeakTracker, recorded at tag:line. Throws std::bad_alloc on failure.*/
+        static void* AllocBlock(std::size_t size, const char* tag, unsigned int line)
+        {
+#if defined(_DEBUG) || defined(DEBUG)
+            void* p = ::operator new(size, tag, (int)line);
+            if (!p)
+                throw std::bad_alloc();
+            return p;
+#else
+            (void)tag;
+            (void)line;
+            return ::operator new(size);
+#endif
+        }
+
+        static void FreeBlock(void* p)
+        {
+            ::operator delete(p);
+        }
+
+        std::atomic<std::size_t> m_allocations;
+        std::atomic<std::size_t> m_deallocations;
+        std::atomic<std::size_t> m_liveBytes;
+        std::atomic<std::size_t> m_peakBytes;
+        /** Sum of all the allocated sizes; compared with m_peakBytes it shows the reallocation churn. */
+        std::atomic<std::size_t> m_totalBytes;
+
+        const char* m_tag;
+        unsigned int m_line;
+
+        /**linked list of the registered stats*/
+        ContainerStats* m_next;
+        ContainerStats* m_prev;
+
+    private:
+        struct ArenaChunk
+        {
+            ArenaChunk* m_next;
+        };
+
+        void* ArenaAllocate(std::size_t size, std::size_t alignment)
+        {
+            std::size_t cursor = ((std::size_t)m_arenaCursor + alignment - 1) & ~(alignment - 1);
+            if (!m_arenaCursor || cursor + size > (std::size_t)m_arenaEnd)
+            {
+                /// Requests bigger than a chunk get a chunk of their own
+                std::size_t chunkSize = sizeof(ArenaChunk) + alignment + (size > m_arenaChunkSize ? size : m_arenaChunkSize);
+                ArenaChunk* chunk = (ArenaChunk*)AllocBlock(chunkSize, m_tag, m_line);
+                chunk->m_next = m_arenaChunks;
+                m_arenaChunks = chunk;
+                m_arenaCursor = (char*)(chunk + 1);
+                m_arenaEnd = (char*)chunk + chunkSize;
+                cursor = ((std::size_t)m_arenaCursor + alignment - 1) & ~(alignment - 1);
+            }
+            m_arenaCursor = (char*)cursor + size;
+            return (void*)cursor;
+        }
+
+        ContainerStats(const ContainerStats&);
+        ContainerStats& operator=(const ContainerStats&);
+
+        std::size_t m_arenaChunkSize;
+        ArenaChunk* m_arenaChunks;
+        char* m_arenaCursor;
+        char* m_arenaEnd;
+    };
+
+    /**
+    * STL allocator that routes the allocations of a container through the LeakTracker, so they
+    * are recorded at a caller supplied site instead of being untracked like std::allocator ones.
+    * Usage:
+    *     mlt::ContainerStats stats("render queue");
+    *     std::vector<int, mlt::TrackingAllocator<int>> v(mlt::TrackingAllocator<int>(&stats));
+    * A default constructed allocator records its allocations at "mlt::TrackingAllocator" and
+    * does not count them.
+    * Like std::pmr, a container keeps its allocator for life: assignment copies/moves the elements
+    * into the destination's own stats, and swapping containers with different stats is not allowed.
+    * Element types aligned above alignof(std::max_align_t) are not supported.*/
+    template <typename T>
+    class TrackingAllocator
+    {
+    public:
+        typedef T value_type;
+
+        static_assert(alignof(T) <= alignof(std::max_align_t), "mlt::TrackingAllocator does not support over-aligned types");
+
+        typedef std::false_type propagate_on_container_copy_assignment;
+        typedef std::false_type propagate_on_container_move_assignment;
+        typedef std::false_type propagate_on_container_swap;
+        typedef std::false_type is_always_equal;
+
+        template <typename U>
+        struct rebind
+        {
+            typedef TrackingAllocator<U> other;
+        };
+
+        TrackingAllocator() noexcept : m_stats(nullptr) {}
+        explicit TrackingAllocator(ContainerStats* stats) noexcept : m_stats(stats) {}
+
+        template <typename U>
+        TrackingAllocator(const TrackingAllocator<U>& other) noexcept : m_stats(other.m_stats) {}
+
+        /** Leaves room for the tracker's record and guards, so the size never wraps.*/
+        std::size_t max_size() const noexcept
+        {
+            return ((std::size_t)-1 / 2) / sizeof(T);
+        }
+
+        T* allocate(std::size_t n)
+        {
+            if (n > max_size())
+                throw std::bad_array_new_length();
+            if (m_stats)
+                return (T*)m_stats->Allocate(n * sizeof(T), alignof(T));
+            return (T*)ContainerStats::AllocBlock(n * sizeof(T), "mlt::TrackingAllocator", 0);
+        }
+
+        void deallocate(T* p, std::size_t n)
+        {
+            if (m_stats)
+                m_stats->Deallocate(p, n * sizeof(T));
+            else
+                ContainerStats::FreeBlock(p);
+        }
+
+        ContainerStats* m_stats;
+    };
+
+    template <typename T, typename U>
+    bool operator==(const TrackingAllocator<T>& a, const TrackingAllocator<U>& b) noexcept
+    {
+        return a.m_stats == b.m_stats;
+    }
+
+    template <typename T, typename U>
+    bool operator!=(const TrackingAllocator<T>& a, const TrackingAllocator<U>& b) noexcept
+    {
+        return a.m_stats != b.m_stats;
+    }
+} //namespace mlt
+
+#if defined(_DEBUG) || defined(DEBUG)
+#define	new new(__FILE__, __LINE__)
+#endif //_DEBUG
+
 #endif //__MEMORYLT_H_INCLUDED__
@@ -42,9 +42,46 @@
 
 #include <cstdio>
 #include <cstdarg>
+#include <cstring>
 #include <thread>
 #include <iostream>
 #include <array>
+#include <algorithm>
+#include <vector>
+#include <csetjmp>
+#include <cstdint>
+#include <chrono>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__APPLE__)
+#include <pthread.h>
+#include <mach/vm_prot.h>
+#include <mach-o/dyld.h>
+#include <mach-o/loader.h>
+#else
+#include <pthread.h>
+#include <link.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define MLT_HAS_RDTSC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define MLT_HAS_RDTSC
+#endif
+
+#if defined(_MSC_VER)
+#define MLT_NOINLINE __declspec(noinline)
+#else
+#define MLT_NOINLINE __attribute__((noinline))
+#endif
 
 
 namespace mlt
@@ -78,6 +115,25 @@ namespace mlt
         MemoryAllocationRecord* m_prev;
     };
 
+    /**
+    * Self profiling counters of one thread. Only the owning thread writes them (so the
+    * updates are plain load/store), other threads may read them at any time.*/
+    struct ThreadProfile
+    {
+        int m_threadIndex;
+        std::atomic<std::uint64_t> m_lockAcquires;
+        std::atomic<std::uint64_t> m_contendedAcquires;
+        std::atomic<std::uint64_t> m_lockWaitTicks;
+        std::atomic<std::uint64_t> m_lockHoldTicks;
+        std::atomic<std::uint64_t> m_lockWaitHistogram[kProfileHistogramBuckets];
+        std::atomic<std::uint64_t> m_lockHoldHistogram[kProfileHistogramBuckets];
+        std::atomic<std::uint64_t> m_phaseCalls[ProfilePhaseCount];
+        std::atomic<std::uint64_t> m_phaseTicks[ProfilePhaseCount];
+
+        /**linked list next node*/
+        ThreadProfile* m_next;
+    };
+
 	class LeakTracker
 	{
 	public:
@@ -92,17 +148,58 @@ namespace mlt
 
         void CheckHeapCorruptionAtAddress(void* address);
 
+        /** Classifies the live allocations. The calling thread's stack is scanned from stackLow up. */
+        MLT_NOINLINE LeakSummary ScanForLeaks(const void* stackLow, bool print, int workerThreads, bool listReachable);
+
 	private:
+        /** Locks m_m; with a profile, records the wait and returns the tick of the acquire. */
+        std::uint64_t Lock(ThreadProfile* profile);
+        /** Unlocks m_m; with a profile, records the hold time since acquired. */
+        void Unlock(ThreadProfile* profile, std::uint64_t acquired);
+
 		MemoryAllocationRecord* m_memoryAllocations;
 		int m_memoryAllocationCount;
 		std::recursive_mutex m_m;
 		std::size_t m_maxSize;
 		std::size_t m_maxLine;
+
+        /**
+        * Allocations without a site (std::allocator, ...), recorded only while the reachability scan is
+        * enabled: containers hold pointers to tracked blocks in them, so they are scanned as roots.*/
+        void* AllocUntracked(std::size_t size);
+        void FreeUntracked(MemoryAllocationRecord* rec);
+
+		MemoryAllocationRecord* m_untrackedAllocations;
+		std::mutex m_untrackedMutex;
 	};
 
     static std::mutex m_initMutex;
     static bool s_heapCorruptionEnabled = false;
     static int s_heapCorruptionBuferSize = 2048;
+    static bool s_reachabilityScanEnabled = false;
+    static int s_reachabilityScanThreads = 0;
+
+    /** Adds the calling thread's stack to the ones scanned by ScanForLeaks (once per thread) */
+    static void RegisterThreadStack();
+
+    /** Set while the thread runs a scan: its own allocations (the workers) are not recorded as roots */
+    static thread_local bool s_isScanning = false;
+
+    /** Registered ContainerStats; the mutex is only taken on register/unregister/print, never per allocation */
+    static std::mutex s_containerStatsMutex;
+    static ContainerStats* s_containerStats = nullptr;
+
+    /** Toggled at runtime while other threads read it in every Alloc/Free */
+    static std::atomic<bool> s_profilingEnabled(false);
+    /** Self profiling; the live threads' profiles, plus the sum of the ones of the threads that exited */
+    static std::mutex s_profilesMutex;
+    static ThreadProfile* s_profiles = nullptr;
+    static int s_profileCount = 0;
+    static TrackerProfile s_exitedProfile = TrackerProfile();
+    static int s_exitedThreadCount = 0;
+    static thread_local ThreadProfile* s_threadProfile = nullptr;
+    /** Set once the thread's profile was folded at thread exit: later Alloc/Free of the thread are not profiled */
+    static thread_local bool s_threadProfileReleased = false;
 	static AllocFuncPtr s_allocFuncPtr = nullptr;
 	static FreeFuncPtr  s_freeFuncPtr = nullptr;
 
@@ -113,11 +210,13 @@ namespace mlt
     static LeakTracker* s_leakTracker = nullptr;
 
 
-    void Init(bool heapCorruptionCheck, int buffer)
+    void Init(bool heapCorruptionCheck, int buffer, bool reachabilityScan, int scanThreads)
     {
         std::lock_guard<std::mutex> lk(m_initMutex);
         s_heapCorruptionEnabled = heapCorruptionCheck;
         s_heapCorruptionBuferSize = buffer;
+        s_reachabilityScanEnabled = reachabilityScan;
+        s_reachabilityScanThreads = scanThreads;
         s_leakTracker = new(s_memleakTracker) LeakTracker;
         s_allocFuncPtr = Alloc;
 		s_freeFuncPtr = Free;
@@ -128,9 +227,16 @@ namespace mlt
         std::lock_guard<std::mutex> lk(m_initMutex);
         if (s_leakTracker)
         {
-            s_leakTracker->PrintMemoryLeaks();
+            if (s_profilingEnabled.load(std::memory_order_relaxed))
+                PrintTrackerProfile();
+            PrintContainerStats();
+            if (s_reachabilityScanEnabled)
+                ScanForLeaks(true, s_reachabilityScanThreads, false);
+            else
+                s_leakTracker->PrintMemoryLeaks();
             s_allocFuncPtr = nullptr;
-            s_freeFuncPtr = nullptr;
+            /// s_freeFuncPtr stays set: blocks allocated by the tracker (e.g. by global containers
+            /// using TrackingAllocator) may still be released and must be freed through it.
             //delete s_leakTracker;
             s_leakTracker = nullptr;
         }
@@ -144,6 +250,268 @@ namespace mlt
         s_leakTracker->CheckHeapCorruption();
     }
 
+    LeakSummary ScanForLeaks(bool print, int workerThreads, bool listReachable)
+    {
+        if (!s_leakTracker)
+            return LeakSummary();
+
+        /// Spill the callee-saved registers into this frame, so pointers that live only
+        /// in registers are seen by the stack scan. Everything below this frame belongs
+        /// to the tracker itself and is not scanned.
+        std::jmp_buf registers;
+        setjmp(registers);
+
+        return s_leakTracker->ScanForLeaks(&registers, print, workerThreads, listReachable);
+    }
+
+    void RegisterContainerStats(ContainerStats* stats)
+    {
+        std::lock_guard<std::mutex> lk(s_containerStatsMutex);
+        stats->m_prev = nullptr;
+        stats->m_next = s_containerStats;
+        if (s_containerStats)
+            s_containerStats->m_prev = stats;
+        s_containerStats = stats;
+    }
+
+    void UnregisterContainerStats(ContainerStats* stats)
+    {
+        std::lock_guard<std::mutex> lk(s_containerStatsMutex);
+        if (s_containerStats == stats)
+            s_containerStats = stats->m_next;
+        if (stats->m_prev)
+            stats->m_prev->m_next = stats->m_next;
+        if (stats->m_next)
+            stats->m_next->m_prev = stats->m_prev;
+        stats->m_next = nullptr;
+        stats->m_prev = nullptr;
+    }
+
+    void PrintContainerStats()
+    {
+        std::lock_guard<std::mutex> lk(s_containerStatsMutex);
+        if (!s_containerStats)
+            return;
+
+        printf("\n");
+        for (ContainerStats* stats = s_containerStats; stats; stats = stats->m_next)
+        {
+            printf("[memory] CONTAINER %s:%d: %zd allocations, %zd deallocations, %zd bytes live, %zd bytes peak, %zd bytes allocated in total.\n",
+                stats->m_tag, stats->m_line,
+                stats->m_allocations.load(), stats->m_deallocations.load(),
+                stats->m_liveBytes.load(), stats->m_peakBytes.load(), stats->m_totalBytes.load());
+        }
+    }
+
+    static std::uint64_t ReadTicks()
+    {
+#if defined(MLT_HAS_RDTSC)
+        return __rdtsc();
+#else
+        return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /** Single writer add: the counter belongs to the calling thread. */
+    static void AddToCounter(std::atomic<std::uint64_t>& counter, std::uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    static void AddToHistogram(std::atomic<std::uint64_t>* histogram, std::uint64_t ticks)
+    {
+        int bucket = 0;
+        while ((ticks >>= 1) != 0 && bucket < kProfileHistogramBuckets - 1)
+            ++bucket;
+        AddToCounter(histogram[bucket], 1);
+    }
+
+    /** Records the ticks spent in phase since start and returns the current tick. */
+    static std::uint64_t RecordPhase(ThreadProfile* profile, ProfilePhase phase, std::uint64_t start)
+    {
+        std::uint64_t now = ReadTicks();
+        AddToCounter(profile->m_phaseCalls[phase], 1);
+        AddToCounter(profile->m_phaseTicks[phase], now - start);
+        return now;
+    }
+
+    static void CopyProfile(const ThreadProfile& from, TrackerProfile& to);
+    static void AccumulateProfile(const TrackerProfile& from, TrackerProfile& to);
+
+    /** Folds the thread's profile into s_exitedProfile and frees it when the thread exits */
+    struct ThreadProfileOwner
+    {
+        ~ThreadProfileOwner()
+        {
+            ThreadProfile* profile = s_threadProfile;
+            if (!profile)
+                return;
+
+            {
+                std::lock_guard<std::mutex> lk(s_profilesMutex);
+                ThreadProfile** link = &s_profiles;
+                while (*link != profile)
+                    link = &(*link)->m_next;
+                *link = profile->m_next;
+
+                TrackerProfile copy;
+                CopyProfile(*profile, copy);
+                AccumulateProfile(copy, s_exitedProfile);
+                s_exitedProfile.m_threadIndex = -1;
+                s_exitedThreadCount++;
+            }
+
+            s_threadProfile = nullptr;
+            s_threadProfileReleased = true;
+            profile->~ThreadProfile();
+            free(profile);
+        }
+    };
+
+    static ThreadProfile* GetThreadProfile()
+    {
+        if (s_threadProfile)
+            return s_threadProfile;
+        if (s_threadProfileReleased)
+            return nullptr;
+
+        /// calloc: must not go back into the tracker
+        void* mem = calloc(1, sizeof(ThreadProfile));
+        if (!mem)
+            return nullptr;
+
+        ThreadProfile* profile = new (mem) ThreadProfile();
+
+        std::lock_guard<std::mutex> lk(s_profilesMutex);
+        profile->m_threadIndex = s_profileCount++;
+        profile->m_next = s_profiles;
+        s_profiles = profile;
+        s_threadProfile = profile;
+
+        /// constructed after s_threadProfile is set: its registration may allocate
+        static thread_local ThreadProfileOwner owner;
+        (void)owner;
+        return profile;
+    }
+
+    static void CopyProfile(const ThreadProfile& from, TrackerProfile& to)
+    {
+        to.m_threadIndex = from.m_threadIndex;
+        to.m_lockAcquires = from.m_lockAcquires;
+        to.m_contendedAcquires = from.m_contendedAcquires;
+        to.m_lockWaitTicks = from.m_lockWaitTicks;
+        to.m_lockHoldTicks = from.m_lockHoldTicks;
+        for (int i = 0; i < kProfileHistogramBuckets; i++)
+        {
+            to.m_lockWaitHistogram[i] = from.m_lockWaitHistogram[i];
+            to.m_lockHoldHistogram[i] = from.m_lockHoldHistogram[i];
+        }
+        for (int i = 0; i < ProfilePhaseCount; i++)
+        {
+            to.m_phaseCalls[i] = from.m_phaseCalls[i];
+            to.m_phaseTicks[i] = from.m_phaseTicks[i];
+        }
+    }
+
+    static void AccumulateProfile(const TrackerProfile& from, TrackerProfile& to)
+    {
+        to.m_lockAcquires += from.m_lockAcquires;
+        to.m_contendedAcquires += from.m_contendedAcquires;
+        to.m_lockWaitTicks += from.m_lockWaitTicks;
+        to.m_lockHoldTicks += from.m_lockHoldTicks;
+        for (int i = 0; i < kProfileHistogramBuckets; i++)
+        {
+            to.m_lockWaitHistogram[i] += from.m_lockWaitHistogram[i];
+            to.m_lockHoldHistogram[i] += from.m_lockHoldHistogram[i];
+        }
+        for (int i = 0; i < ProfilePhaseCount; i++)
+        {
+            to.m_phaseCalls[i] += from.m_phaseCalls[i];
+            to.m_phaseTicks[i] += from.m_phaseTicks[i];
+        }
+    }
+
+    static unsigned long long TicksPerCall(const TrackerProfile& profile, ProfilePhase phase)
+    {
+        return profile.m_phaseCalls[phase] ? profile.m_phaseTicks[phase] / profile.m_phaseCalls[phase] : 0;
+    }
+
+    static void PrintProfileLine(const char* label, const TrackerProfile& profile)
+    {
+        printf("[memory] PROFILE %s: %llu lock acquires (%llu contended), wait %llu ticks, hold %llu ticks, "
+            "alloc block/link %llu/%llu ticks per call, free check/unlink/release %llu/%llu/%llu ticks per call.\n",
+            label,
+            profile.m_lockAcquires, profile.m_contendedAcquires, profile.m_lockWaitTicks, profile.m_lockHoldTicks,
+            TicksPerCall(profile, ProfilePhaseAllocBlock), TicksPerCall(profile, ProfilePhaseAllocLink),
+            TicksPerCall(profile, ProfilePhaseFreeCheck), TicksPerCall(profile, ProfilePhaseFreeUnlink),
+            TicksPerCall(profile, ProfilePhaseFreeRelease));
+    }
+
+    static void PrintProfileHistogram(const char* name, const unsigned long long* histogram)
+    {
+        printf("[memory] PROFILE %s histogram (ticks):", name);
+        for (int i = 0; i < kProfileHistogramBuckets; i++)
+        {
+            if (histogram[i])
+                printf(" [%llu, %llu): %llu", i ? 1ull << i : 0ull, 2ull << i, histogram[i]);
+        }
+        printf("\n");
+    }
+
+    void EnableProfiling(bool enabled)
+    {
+        s_profilingEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    int GetTrackerProfiles(TrackerProfile* profiles, int maxProfiles)
+    {
+        std::lock_guard<std::mutex> lk(s_profilesMutex);
+        int count = 0;
+        for (ThreadProfile* profile = s_profiles; profile; profile = profile->m_next, ++count)
+        {
+            if (count < maxProfiles)
+                CopyProfile(*profile, profiles[count]);
+        }
+        if (s_exitedThreadCount)
+        {
+            if (count < maxProfiles)
+                profiles[count] = s_exitedProfile;
+            ++count;
+        }
+        return count;
+    }
+
+    void PrintTrackerProfile()
+    {
+        std::lock_guard<std::mutex> lk(s_profilesMutex);
+        if (!s_profiles && !s_exitedThreadCount)
+            return;
+
+        printf("\n");
+        TrackerProfile total = TrackerProfile();
+        for (ThreadProfile* profile = s_profiles; profile; profile = profile->m_next)
+        {
+            TrackerProfile copy;
+            CopyProfile(*profile, copy);
+            char label[32];
+            snprintf(label, sizeof(label), "thread %d", copy.m_threadIndex);
+            PrintProfileLine(label, copy);
+            AccumulateProfile(copy, total);
+        }
+        if (s_exitedThreadCount)
+        {
+            char label[32];
+            snprintf(label, sizeof(label), "exited threads (%d)", s_exitedThreadCount);
+            PrintProfileLine(label, s_exitedProfile);
+            AccumulateProfile(s_exitedProfile, total);
+        }
+
+        PrintProfileLine("all threads", total);
+        PrintProfileHistogram("lock wait", total.m_lockWaitHistogram);
+        PrintProfileHistogram("lock hold", total.m_lockHoldHistogram);
+    }
+
     void* Alloc(std::size_t size, const char* file, unsigned int line)
     {
         return s_leakTracker->Alloc(size, file, line);
@@ -151,19 +519,23 @@ namespace mlt
 
     void LeakTrackerExit()
     {
+        /// s_freeFuncPtr stays set, see Close
         s_allocFuncPtr = nullptr;
-        s_freeFuncPtr = nullptr;
 
 		if (s_leakTracker)
 		{
-			s_leakTracker->PrintMemoryLeaks();
+            if (s_reachabilityScanEnabled)
+                ScanForLeaks(true, s_reachabilityScanThreads, false);
+            else
+                s_leakTracker->PrintMemoryLeaks();
             s_leakTracker = nullptr;
 		}
     }
 
     void Free(void* mem)
     {
-        s_leakTracker->Free(mem);
+        /// Also used after Close (s_leakTracker is null then); the tracker itself is never destroyed
+        reinterpret_cast<LeakTracker*>(s_memleakTracker)->Free(mem);
     }
 
 
@@ -172,6 +544,7 @@ namespace mlt
         , m_memoryAllocationCount(0)
         , m_maxSize(0)
         , m_maxLine(0)
+        , m_untrackedAllocations(0)
     {
         atexit(LeakTrackerExit);
 
@@ -182,13 +555,57 @@ namespace mlt
     {
     }
 
+    std::uint64_t LeakTracker::Lock(ThreadProfile* profile)
+    {
+        if (!profile)
+        {
+            m_m.lock();
+            return 0;
+        }
+
+        std::uint64_t start = ReadTicks();
+        if (!m_m.try_lock())
+        {
+            AddToCounter(profile->m_contendedAcquires, 1);
+            m_m.lock();
+        }
+        std::uint64_t acquired = ReadTicks();
+
+        AddToCounter(profile->m_lockAcquires, 1);
+        AddToCounter(profile->m_lockWaitTicks, acquired - start);
+        AddToHistogram(profile->m_lockWaitHistogram, acquired - start);
+        return acquired;
+    }
+
+    void LeakTracker::Unlock(ThreadProfile* profile, std::uint64_t acquired)
+    {
+        if (!profile)
+        {
+            m_m.unlock();
+            return;
+        }
+
+        std::uint64_t released = ReadTicks();
+        m_m.unlock();
+
+        AddToCounter(profile->m_lockHoldTicks, released - acquired);
+        AddToHistogram(profile->m_lockHoldHistogram, released - acquired);
+    }
+
     void* LeakTracker::Alloc(std::size_t size, const char* file, unsigned int line)
     {
+        RegisterThreadStack();
+
         if (file == nullptr)
         {
+            if (s_reachabilityScanEnabled && !s_isScanning)
+                return AllocUntracked(size);
             return malloc(size);
         }
 
+        ThreadProfile* profile = s_profilingEnabled.load(std::memory_order_relaxed) ? GetThreadProfile() : nullptr;
+        std::uint64_t ticks = profile ? ReadTicks() : 0;
+
         unsigned char* mem = nullptr;
         MemoryAllocationRecord* rec = nullptr;
         void* payloadAddr = nullptr;
@@ -218,9 +635,13 @@ namespace mlt
             payloadAddr = mem + sizeof(MemoryAllocationRecord);
         }
 
-        
+        if (!mem)
+            return nullptr;
+
+        if (profile)
+            ticks = RecordPhase(profile, ProfilePhaseAllocBlock, ticks);
 
-        m_m.lock();
+        std::uint64_t acquired = Lock(profile);
         rec->m_address = payloadAddr;
         rec->m_size = (unsigned int)size;
         rec->m_file = file;
@@ -238,15 +659,63 @@ namespace mlt
         m_memoryAllocations = rec;
         ++m_memoryAllocationCount;
 
-        m_m.unlock();
+        Unlock(profile, acquired);
+
+        if (profile)
+            RecordPhase(profile, ProfilePhaseAllocLink, ticks);
+        return payloadAddr;
+    }
+
+    void* LeakTracker::AllocUntracked(std::size_t size)
+    {
+        /// Allocate memory + size for a MemoryAlloctionRecord (no heap corruption buffers)
+        /// | MemoryAllocationRecord (m_file == nullptr) | allocated memory of size |
+        /// ^                                            ^
+        /// rec                                          payloadAddr
+        MemoryAllocationRecord* rec = (MemoryAllocationRecord*)malloc(sizeof(MemoryAllocationRecord) + size);
+        if (!rec)
+            return nullptr;
+
+        void* payloadAddr = rec + 1;
+        rec->m_address = payloadAddr;
+        rec->m_size = size;
+        rec->m_file = nullptr;
+        rec->m_line = 0;
+        rec->m_prev = 0;
+
+        std::lock_guard<std::mutex> lk(m_untrackedMutex);
+        rec->m_next = m_untrackedAllocations;
+        if (m_untrackedAllocations)
+            m_untrackedAllocations->m_prev = rec;
+        m_untrackedAllocations = rec;
         return payloadAddr;
     }
 
+    void LeakTracker::FreeUntracked(MemoryAllocationRecord* rec)
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_untrackedMutex);
+            if (m_untrackedAllocations == rec)
+                m_untrackedAllocations = rec->m_next;
+            if (rec->m_prev)
+                rec->m_prev->m_next = rec->m_next;
+            if (rec->m_next)
+                rec->m_next->m_prev = rec->m_prev;
+        }
+
+        free(rec);
+    }
+
     void LeakTracker::Free(void* payloadAddr)
     {
         if (payloadAddr == 0)
             return;
 
+        RegisterThreadStack();
+
+        bool profiling = s_profilingEnabled.load(std::memory_order_relaxed);
+        std::uint64_t ticks = profiling ? ReadTicks() : 0;
+
         unsigned char* mem = nullptr;
         MemoryAllocationRecord* rec = nullptr;
 
@@ -273,6 +742,12 @@ namespace mlt
             return;
         }
 
+        if (rec->m_file == nullptr)
+        {
+            FreeUntracked(rec);
+            return;
+        }
+
         /// Sanity check: ensure that size is smaller than maximum (tracked)
         if (rec->m_size > m_maxSize)
         {
@@ -289,13 +764,19 @@ namespace mlt
             return;
         }
 
+        /// Only tracked blocks get a profile: threads that free just untracked memory must not create one
+        ThreadProfile* profile = profiling ? GetThreadProfile() : nullptr;
+
         if (s_heapCorruptionEnabled)
         {
             CheckHeapCorruptionAtAddress(payloadAddr);
         }
 
+        if (profile)
+            ticks = RecordPhase(profile, ProfilePhaseFreeCheck, ticks);
+
         /// Link this item out
-        m_m.lock();
+        std::uint64_t acquired = Lock(profile);
         if (m_memoryAllocations == rec)
             m_memoryAllocations = rec->m_next;
         if (rec->m_prev)
@@ -303,10 +784,16 @@ namespace mlt
         if (rec->m_next)
             rec->m_next->m_prev = rec->m_prev;
         --m_memoryAllocationCount;
-        m_m.unlock();
+        Unlock(profile, acquired);
+
+        if (profile)
+            ticks = RecordPhase(profile, ProfilePhaseFreeUnlink, ticks);
 
         /// Free the address from the original alloc location (before mem allocation record)
         free(mem);
+
+        if (profile)
+            RecordPhase(profile, ProfilePhaseFreeRelease, ticks);
     }
 
     void LeakTracker::PrintMemoryLeaks()
@@ -381,6 +868,669 @@ namespace mlt
             rec = rec->m_next;
         }
     }
+
+    /** Address range [m_begin, m_end) scanned for pointers into tracked blocks. */
+    struct ScanRange
+    {
+        std::uintptr_t m_begin;
+        std::uintptr_t m_end;
+    };
+
+    /** Entry of the address index, sorted by m_begin. */
+    struct ScanBlock
+    {
+        std::uintptr_t m_begin;
+        std::uintptr_t m_end;
+        MemoryAllocationRecord* m_rec;
+    };
+
+    static const unsigned char kScanUnvisited = 0;
+    static const unsigned char kScanReachable = 1;
+    static const unsigned char kScanIndirect = 2;
+    /** Indirect block reached from a direct leak; blocks still kScanIndirect after that form leaked cycles */
+    static const unsigned char kScanIndirectReached = 3;
+
+    static const std::size_t kScanNotFound = (std::size_t)-1;
+
+    /** Roots are split in chunks of this size, so the workers can share big segments. */
+    static const std::size_t kScanChunkSize = 64 * 1024;
+
+    /**
+    * Growable array used by the scan. It goes straight to malloc/realloc, so it never
+    * enters the tracker (m_m is held by the scan) and is never scanned itself.*/
+    template <typename T>
+    struct ScanArray
+    {
+        T* m_data;
+        std::size_t m_count;
+        std::size_t m_capacity;
+
+        ScanArray() : m_data(nullptr), m_count(0), m_capacity(0) {}
+        ~ScanArray() { free(m_data); }
+
+        bool Push(const T& value)
+        {
+            if (m_count == m_capacity)
+            {
+                std::size_t capacity = m_capacity ? m_capacity * 2 : 256;
+                T* data = (T*)realloc(m_data, capacity * sizeof(T));
+                if (!data)
+                    return false;
+                m_data = data;
+                m_capacity = capacity;
+            }
+            m_data[m_count++] = value;
+            return true;
+        }
+
+    private:
+        ScanArray(const ScanArray&);
+        ScanArray& operator=(const ScanArray&);
+    };
+
+    /** State shared by the workers of one reachability scan. */
+    struct ScanContext
+    {
+        const ScanBlock* m_blocks;
+        std::atomic<unsigned char>* m_states;
+        std::size_t m_blockCount;
+
+        /** Lowest begin and highest end of all blocks, for a quick reject. */
+        std::uintptr_t m_low;
+        std::uintptr_t m_high;
+
+        const ScanRange* m_roots;
+        std::size_t m_rootCount;
+
+        const std::size_t* m_candidates;
+        std::size_t m_candidateCount;
+
+        /** Next root chunk (phase 1) or candidate (phase 2, 3) to be claimed by a worker. */
+        std::atomic<std::size_t> m_next;
+    };
+
+    static void AddScanRange(ScanArray<ScanRange>& roots, std::uintptr_t begin, std::uintptr_t end)
+    {
+        while (begin < end)
+        {
+            ScanRange range;
+            range.m_begin = begin;
+            range.m_end = (end - begin > kScanChunkSize) ? begin + kScanChunkSize : end;
+            roots.Push(range);
+            begin = range.m_end;
+        }
+    }
+
+    /** Stack of a live thread that went through the tracker; linked in s_threadStacks. */
+    struct ThreadStack
+    {
+        ThreadStack();
+        ~ThreadStack();
+
+        std::uintptr_t m_low;
+        std::uintptr_t m_high;
+        /** Windows: the thread's NT_TIB, read at scan time because the committed part of the stack grows */
+        void* m_native;
+
+        /**linked list next node*/
+        ThreadStack* m_next;
+        /**linked list prev node*/
+        ThreadStack* m_prev;
+    };
+
+    /** Taken by ScanForLeaks for the whole scan, so no registered stack is released while it is read */
+    static std::mutex s_threadStacksMutex;
+    static ThreadStack* s_threadStacks = nullptr;
+    static thread_local ThreadStack* s_currentThreadStack = nullptr;
+    static thread_local bool s_threadStackRegistered = false;
+    /** Scan workers are never registered: their stacks hold copies of the scanned words */
+    static thread_local bool s_isScanWorker = false;
+
+#if defined(_WIN32)
+    static void AddModuleSections(ScanArray<ScanRange>& roots, unsigned char* base)
+    {
+        IMAGE_DOS_HEADER* dos = (IMAGE_DOS_HEADER*)base;
+        IMAGE_NT_HEADERS* nt = (IMAGE_NT_HEADERS*)(base + dos->e_lfanew);
+        IMAGE_SECTION_HEADER* section = IMAGE_FIRST_SECTION(nt);
+        for (WORD i = 0; i < nt->FileHeader.NumberOfSections; i++, section++)
+        {
+            if (section->Characteristics & IMAGE_SCN_MEM_WRITE)
+            {
+                std::uintptr_t begin = (std::uintptr_t)(base + section->VirtualAddress);
+                AddScanRange(roots, begin, begin + section->Misc.VirtualSize);
+            }
+        }
+    }
+
+    static void AddDataSegments(ScanArray<ScanRange>& roots)
+    {
+        /// Writable sections (.data, .bss, ...) of every loaded module
+        HANDLE process = GetCurrentProcess();
+        DWORD size = 0;
+        HMODULE* modules = nullptr;
+        if (EnumProcessModules(process, NULL, 0, &size) && size)
+            modules = (HMODULE*)malloc(size);
+
+        DWORD needed = 0;
+        if (!modules || !EnumProcessModules(process, modules, size, &needed))
+        {
+            free(modules);
+            AddModuleSections(roots, (unsigned char*)GetModuleHandle(NULL));
+            return;
+        }
+
+        DWORD count = (needed < size ? needed : size) / sizeof(HMODULE);
+        for (DWORD i = 0; i < count; i++)
+        {
+            AddModuleSections(roots, (unsigned char*)modules[i]);
+        }
+        free(modules);
+    }
+
+    static std::uintptr_t GetStackHigh()
+    {
+        return (std::uintptr_t)((NT_TIB*)NtCurrentTeb())->StackBase;
+    }
+
+    ThreadStack::ThreadStack()
+        : m_low(0)
+        , m_high(0)
+        , m_native(NtCurrentTeb())
+        , m_next(nullptr)
+        , m_prev(nullptr)
+    {
+    }
+
+    static bool GetThreadStackRange(const ThreadStack& stack, std::uintptr_t& low, std::uintptr_t& high)
+    {
+        /// Only [StackLimit, StackBase) is committed
+        NT_TIB* tib = (NT_TIB*)stack.m_native;
+        low = (std::uintptr_t)tib->StackLimit;
+        high = (std::uintptr_t)tib->StackBase;
+        return low < high;
+    }
+#elif defined(__APPLE__)
+    static void AddDataSegments(ScanArray<ScanRange>& roots)
+    {
+        /// Every writable segment of every image (__DATA, __DATA_DIRTY, __DATA_CONST, ...)
+        for (uint32_t i = 0; i < _dyld_image_count(); i++)
+        {
+            const struct mach_header* header = _dyld_get_image_header(i);
+            std::uintptr_t slide = (std::uintptr_t)_dyld_get_image_vmaddr_slide(i);
+#if defined(__LP64__)
+            const unsigned char* command = (const unsigned char*)header + sizeof(struct mach_header_64);
+#else
+            const unsigned char* command = (const unsigned char*)header + sizeof(struct mach_header);
+#endif
+            for (uint32_t c = 0; c < header->ncmds; c++)
+            {
+                const struct load_command* load = (const struct load_command*)command;
+#if defined(__LP64__)
+                if (load->cmd == LC_SEGMENT_64)
+                {
+                    const struct segment_command_64* segment = (const struct segment_command_64*)load;
+#else
+                if (load->cmd == LC_SEGMENT)
+                {
+                    const struct segment_command* segment = (const struct segment_command*)load;
+#endif
+                    if ((segment->initprot & VM_PROT_WRITE) && segment->vmsize)
+                        AddScanRange(roots, (std::uintptr_t)segment->vmaddr + slide, (std::uintptr_t)(segment->vmaddr + segment->vmsize) + slide);
+                }
+                command += load->cmdsize;
+            }
+        }
+    }
+
+    static std::uintptr_t GetStackHigh()
+    {
+        return (std::uintptr_t)pthread_get_stackaddr_np(pthread_self());
+    }
+
+    ThreadStack::ThreadStack()
+        : m_low(0)
+        , m_high(GetStackHigh())
+        , m_native(nullptr)
+        , m_next(nullptr)
+        , m_prev(nullptr)
+    {
+        m_low = m_high - pthread_get_stacksize_np(pthread_self());
+    }
+
+    static bool GetThreadStackRange(const ThreadStack& stack, std::uintptr_t& low, std::uintptr_t& high)
+    {
+        low = stack.m_low;
+        high = stack.m_high;
+        return low < high;
+    }
+#else
+    static int AddDataSegmentsCallback(struct dl_phdr_info* info, std::size_t, void* data)
+    {
+        ScanArray<ScanRange>& roots = *(ScanArray<ScanRange>*)data;
+        for (int i = 0; i < info->dlpi_phnum; i++)
+        {
+            const ElfW(Phdr)& phdr = info->dlpi_phdr[i];
+            if (phdr.p_type == PT_LOAD && (phdr.p_flags & PF_W))
+            {
+                std::uintptr_t begin = (std::uintptr_t)(info->dlpi_addr + phdr.p_vaddr);
+                AddScanRange(roots, begin, begin + phdr.p_memsz);
+            }
+        }
+        return 0;
+    }
+
+    static void AddDataSegments(ScanArray<ScanRange>& roots)
+    {
+        /// Writable PT_LOAD segments of every loaded object (.data, .bss, ...)
+        dl_iterate_phdr(AddDataSegmentsCallback, &roots);
+    }
+
+    static void GetStackBounds(std::uintptr_t& low, std::uintptr_t& high)
+    {
+        low = 0;
+        high = 0;
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) == 0)
+        {
+            void* addr = nullptr;
+            std::size_t size = 0;
+            if (pthread_attr_getstack(&attr, &addr, &size) == 0)
+            {
+                low = (std::uintptr_t)addr;
+                high = (std::uintptr_t)addr + size;
+            }
+            pthread_attr_destroy(&attr);
+        }
+    }
+
+    static std::uintptr_t GetStackHigh()
+    {
+        std::uintptr_t low = 0;
+        std::uintptr_t high = 0;
+        GetStackBounds(low, high);
+        return high;
+    }
+
+    ThreadStack::ThreadStack()
+        : m_low(0)
+        , m_high(0)
+        , m_native(nullptr)
+        , m_next(nullptr)
+        , m_prev(nullptr)
+    {
+        GetStackBounds(m_low, m_high);
+    }
+
+    static bool GetThreadStackRange(const ThreadStack& stack, std::uintptr_t& low, std::uintptr_t& high)
+    {
+        /// The main thread's stack is reported with its full rlimit size, but only the part that
+        /// is already mapped can be read: clip low to the start of the mapping that holds the top.
+        low = stack.m_low;
+        high = stack.m_high;
+        FILE* maps = fopen("/proc/self/maps", "r");
+        if (!maps)
+            return false;
+
+        bool found = false;
+        bool lineStart = true;
+        char line[512];
+        while (!found && fgets(line, sizeof(line), maps))
+        {
+            unsigned long begin = 0;
+            unsigned long end = 0;
+            if (lineStart && sscanf(line, "%lx-%lx", &begin, &end) == 2 && begin < high && high <= end)
+            {
+                if (low < begin)
+                    low = begin;
+                found = true;
+            }
+            lineStart = strchr(line, '\n') != nullptr;
+        }
+        fclose(maps);
+        return found && low < high;
+    }
+#endif
+
+    ThreadStack::~ThreadStack()
+    {
+        std::lock_guard<std::mutex> lk(s_threadStacksMutex);
+        if (s_threadStacks == this)
+            s_threadStacks = m_next;
+        if (m_prev)
+            m_prev->m_next = m_next;
+        if (m_next)
+            m_next->m_prev = m_prev;
+        s_currentThreadStack = nullptr;
+    }
+
+    static void RegisterThreadStack()
+    {
+        if (s_threadStackRegistered || s_isScanWorker)
+            return;
+        s_threadStackRegistered = true;
+
+        /// Constructed on the first call, unregistered by its destructor when the thread exits
+        static thread_local ThreadStack threadStack;
+
+        std::lock_guard<std::mutex> lk(s_threadStacksMutex);
+        threadStack.m_next = s_threadStacks;
+        if (s_threadStacks)
+            s_threadStacks->m_prev = &threadStack;
+        s_threadStacks = &threadStack;
+        s_currentThreadStack = &threadStack;
+    }
+
+    /** Returns the index of the block that contains value, or kScanNotFound. */
+    static std::size_t FindScanBlock(const ScanContext& ctx, std::uintptr_t value)
+    {
+        if (value < ctx.m_low || value >= ctx.m_high)
+            return kScanNotFound;
+
+        /// First block that begins after value; the one before it is the only candidate.
+        std::size_t lo = 0;
+        std::size_t hi = ctx.m_blockCount;
+        while (lo < hi)
+        {
+            std::size_t mid = lo + (hi - lo) / 2;
+            if (ctx.m_blocks[mid].m_begin <= value)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if (lo == 0 || value >= ctx.m_blocks[lo - 1].m_end)
+            return kScanNotFound;
+        return lo - 1;
+    }
+
+    /**
+    * Scans every aligned word in [begin, end) and moves the blocks it points into from state from to
+    * state to. Newly marked blocks are pushed to pending (if any). The block self is never marked.*/
+    static void ScanWords(ScanContext& ctx, std::uintptr_t begin, std::uintptr_t end,
+        unsigned char from, unsigned char to, std::size_t self, ScanArray<std::size_t>* pending)
+    {
+        begin = (begin + sizeof(void*) - 1) & ~(std::uintptr_t)(sizeof(void*) - 1);
+        for (; begin + sizeof(void*) <= end; begin += sizeof(void*))
+        {
+            std::size_t index = FindScanBlock(ctx, *(const std::uintptr_t*)begin);
+            if (index == kScanNotFound || index == self)
+                continue;
+
+            unsigned char expected = from;
+            if (ctx.m_states[index].compare_exchange_strong(expected, to) && pending)
+                pending->Push(index);
+        }
+    }
+
+    /** Phase 1: marks everything reachable from the roots. */
+    static void MarkReachableWorker(ScanContext* ctx)
+    {
+        ScanArray<std::size_t> pending;
+        for (;;)
+        {
+            std::size_t i = ctx->m_next.fetch_add(1);
+            if (i >= ctx->m_rootCount)
+                break;
+
+            ScanWords(*ctx, ctx->m_roots[i].m_begin, ctx->m_roots[i].m_end, kScanUnvisited, kScanReachable, kScanNotFound, &pending);
+
+            while (pending.m_count)
+            {
+                const ScanBlock& block = ctx->m_blocks[pending.m_data[--pending.m_count]];
+                ScanWords(*ctx, block.m_begin, block.m_begin + block.m_rec->m_size, kScanUnvisited, kScanReachable, kScanNotFound, &pending);
+            }
+        }
+    }
+
+    /**
+    * Phase 2: every block left unvisited by phase 1 is scanned once, and the blocks it points to
+    * are indirectly leaked. What is still unvisited afterwards is referenced by nothing.*/
+    static void MarkIndirectWorker(ScanContext* ctx)
+    {
+        for (;;)
+        {
+            std::size_t i = ctx->m_next.fetch_add(1);
+            if (i >= ctx->m_candidateCount)
+                break;
+
+            const ScanBlock& block = ctx->m_blocks[ctx->m_candidates[i]];
+            ScanWords(*ctx, block.m_begin, block.m_begin + block.m_rec->m_size, kScanUnvisited, kScanIndirect, ctx->m_candidates[i], nullptr);
+        }
+    }
+
+    /** Marks as kScanIndirectReached every indirect block reachable from the leaked block index. */
+    static void MarkReachedFromLeak(ScanContext& ctx, std::size_t index, ScanArray<std::size_t>& pending)
+    {
+        pending.Push(index);
+        while (pending.m_count)
+        {
+            const ScanBlock& block = ctx.m_blocks[pending.m_data[--pending.m_count]];
+            ScanWords(ctx, block.m_begin, block.m_begin + block.m_rec->m_size, kScanIndirect, kScanIndirectReached, kScanNotFound, &pending);
+        }
+    }
+
+    /**
+    * Phase 3: floods from the direct leaks. The indirect blocks it does not reach only point to
+    * each other (a leaked cycle, like a doubly linked list) and are handled by ScanForLeaks.*/
+    static void MarkReachedFromLeaksWorker(ScanContext* ctx)
+    {
+        ScanArray<std::size_t> pending;
+        for (;;)
+        {
+            std::size_t i = ctx->m_next.fetch_add(1);
+            if (i >= ctx->m_candidateCount)
+                break;
+
+            if (ctx->m_states[ctx->m_candidates[i]] == kScanUnvisited)
+                MarkReachedFromLeak(*ctx, ctx->m_candidates[i], pending);
+        }
+    }
+
+    static void ScanWorkerMain(void (*worker)(ScanContext*), ScanContext* ctx)
+    {
+        s_isScanWorker = true;
+        worker(ctx);
+    }
+
+    /** Runs worker on workerThreads threads, the calling thread being one of them. */
+    static void RunScanWorkers(void (*worker)(ScanContext*), ScanContext& ctx, int workerThreads)
+    {
+        ctx.m_next = 0;
+
+        std::vector<std::thread> threads;
+        for (int i = 1; i < workerThreads; i++)
+        {
+            threads.push_back(std::thread(ScanWorkerMain, worker, &ctx));
+        }
+
+        worker(&ctx);
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    static void PrintScanClass(const ScanContext& ctx, unsigned char state, const char* label)
+    {
+        for (std::size_t i = 0; i < ctx.m_blockCount; i++)
+        {
+            const MemoryAllocationRecord* rec = ctx.m_blocks[i].m_rec;
+            if (ctx.m_states[i] == state && strlen(rec->m_file) > 0)
+            {
+                printf("[memory] %s: At address %p, size %zd, %s:%d.\n", label, rec->m_address, rec->m_size, rec->m_file, rec->m_line);
+            }
+        }
+    }
+
+    LeakSummary LeakTracker::ScanForLeaks(const void* stackLow, bool print, int workerThreads, bool listReachable)
+    {
+        LeakSummary summary = LeakSummary();
+
+        /// Register before taking s_threadStacksMutex: creating the workers enters the tracker.
+        /// The workers are allocated untracked (s_isScanning), so they do not need m_untrackedMutex.
+        RegisterThreadStack();
+        s_isScanning = true;
+
+        std::lock_guard<std::recursive_mutex> lk(m_m);
+        std::lock_guard<std::mutex> untrackedLock(m_untrackedMutex);
+        std::lock_guard<std::mutex> stacksLock(s_threadStacksMutex);
+
+        if (workerThreads <= 0)
+            workerThreads = (int)std::thread::hardware_concurrency();
+        if (workerThreads <= 0)
+            workerThreads = 1;
+
+        /// Build the sorted address index
+        std::size_t blockCount = (std::size_t)m_memoryAllocationCount;
+        ScanBlock* blocks = (ScanBlock*)malloc(blockCount * sizeof(ScanBlock) + 1);
+        std::atomic<unsigned char>* states = (std::atomic<unsigned char>*)malloc(blockCount * sizeof(std::atomic<unsigned char>) + 1);
+        if (!blocks || !states)
+        {
+            free(blocks);
+            free(states);
+            printf("[memory] WARNING: not enough memory for the reachability scan.\n");
+            s_isScanning = false;
+            return summary;
+        }
+
+        std::size_t count = 0;
+        for (MemoryAllocationRecord* rec = m_memoryAllocations; rec && count < blockCount; rec = rec->m_next)
+        {
+            /// Zero sized blocks still own their address
+            blocks[count].m_begin = (std::uintptr_t)rec->m_address;
+            blocks[count].m_end = blocks[count].m_begin + (rec->m_size ? rec->m_size : 1);
+            blocks[count].m_rec = rec;
+            new (&states[count]) std::atomic<unsigned char>(kScanUnvisited);
+            ++count;
+        }
+        blockCount = count;
+
+        std::sort(blocks, blocks + blockCount, [](const ScanBlock& a, const ScanBlock& b) { return a.m_begin < b.m_begin; });
+
+        /// Collect the roots: data/bss segments, the caller's part of its stack, the stacks of the other threads
+        /// and the untracked allocations
+        ScanArray<ScanRange> roots;
+        AddDataSegments(roots);
+        std::uintptr_t stackHigh = GetStackHigh();
+        if (stackHigh > (std::uintptr_t)stackLow)
+            AddScanRange(roots, (std::uintptr_t)stackLow, stackHigh);
+
+        for (ThreadStack* stack = s_threadStacks; stack; stack = stack->m_next)
+        {
+            std::uintptr_t low = 0;
+            std::uintptr_t high = 0;
+            if (stack != s_currentThreadStack && GetThreadStackRange(*stack, low, high))
+                AddScanRange(roots, low, high);
+        }
+
+        for (MemoryAllocationRecord* rec = m_untrackedAllocations; rec; rec = rec->m_next)
+        {
+            AddScanRange(roots, (std::uintptr_t)rec->m_address, (std::uintptr_t)rec->m_address + rec->m_size);
+        }
+
+        ScanContext ctx;
+        ctx.m_blocks = blocks;
+        ctx.m_states = states;
+        ctx.m_blockCount = blockCount;
+        ctx.m_low = blockCount ? blocks[0].m_begin : 0;
+        ctx.m_high = 0;
+        for (std::size_t i = 0; i < blockCount; i++)
+        {
+            if (ctx.m_high < blocks[i].m_end)
+                ctx.m_high = blocks[i].m_end;
+        }
+        ctx.m_roots = roots.m_data;
+        ctx.m_rootCount = roots.m_count;
+        ctx.m_candidates = nullptr;
+        ctx.m_candidateCount = 0;
+
+        RunScanWorkers(MarkReachableWorker, ctx, workerThreads);
+
+        ScanArray<std::size_t> candidates;
+        for (std::size_t i = 0; i < blockCount; i++)
+        {
+            if (states[i] == kScanUnvisited)
+                candidates.Push(i);
+        }
+        ctx.m_candidates = candidates.m_data;
+        ctx.m_candidateCount = candidates.m_count;
+
+        RunScanWorkers(MarkIndirectWorker, ctx, workerThreads);
+
+        RunScanWorkers(MarkReachedFromLeaksWorker, ctx, workerThreads);
+
+        /// Every leaked cycle left has no direct leak: report its first block as one
+        ScanArray<std::size_t> pending;
+        for (std::size_t i = 0; i < candidates.m_count; i++)
+        {
+            std::size_t index = candidates.m_data[i];
+            if (states[index] == kScanIndirect)
+            {
+                states[index] = kScanUnvisited;
+                MarkReachedFromLeak(ctx, index, pending);
+            }
+        }
+
+        for (std::size_t i = 0; i < candidates.m_count; i++)
+        {
+            if (states[candidates.m_data[i]] == kScanIndirectReached)
+                states[candidates.m_data[i]] = kScanIndirect;
+        }
+
+        for (std::size_t i = 0; i < blockCount; i++)
+        {
+            std::size_t size = blocks[i].m_rec->m_size;
+            switch (states[i])
+            {
+            case kScanUnvisited:
+                ++summary.m_unreachableCount;
+                summary.m_unreachableBytes += size;
+                break;
+            case kScanIndirect:
+                ++summary.m_indirectCount;
+                summary.m_indirectBytes += size;
+                break;
+            default:
+                ++summary.m_reachableCount;
+                summary.m_reachableBytes += size;
+                break;
+            }
+        }
+
+        if (print)
+        {
+            printf("\n");
+            if (blockCount == 0)
+            {
+                printf("[memory] All HEAP allocations successfully cleaned up (no leaks detected).\n");
+            }
+            else
+            {
+                printf("[memory] WARNING: %d  HEAP allocations still active in memory: %d unreachable (%zd bytes), %d indirectly leaked (%zd bytes), %d still reachable (%zd bytes).\n",
+                    (int)blockCount,
+                    summary.m_unreachableCount, summary.m_unreachableBytes,
+                    summary.m_indirectCount, summary.m_indirectBytes,
+                    summary.m_reachableCount, summary.m_reachableBytes);
+
+                /// Without the untracked allocations as roots, blocks referenced only from
+                /// containers look unreachable: they are only possible leaks.
+                if (!s_reachabilityScanEnabled)
+                {
+                    printf("[memory] WARNING: untracked allocations are not recorded (Init with reachabilityScan = false), blocks referenced only from them are reported as POSSIBLE LEAK.\n");
+                }
+                PrintScanClass(ctx, kScanUnvisited, s_reachabilityScanEnabled ? "LEAK" : "POSSIBLE LEAK");
+                PrintScanClass(ctx, kScanIndirect, s_reachabilityScanEnabled ? "INDIRECT LEAK" : "POSSIBLE INDIRECT LEAK");
+                if (listReachable)
+                    PrintScanClass(ctx, kScanReachable, "REACHABLE");
+            }
+        }
+
+        free(blocks);
+        free(states);
+        s_isScanning = false;
+        return summary;
+    }
 } //mlt
 
 
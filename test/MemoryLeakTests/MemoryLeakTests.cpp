@@ -1,11 +1,17 @@
 // MemoryLeakTests.cpp : Defines the entry point for the console application.
 //
 
-#include "MemoryLeaksTracker/MemoryLT.h"
-
+// Headers that use placement new must come before MemoryLT.h (it redefines "new").
+#include <string>
+#include <unordered_map>
 #include <thread>
 #include <vector>
 
+#include "MemoryLeaksTracker/MemoryLT.h"
+
+#include <atomic>
+#include <cstdio>
+
 
 int a = 0;
 
@@ -22,6 +28,21 @@ public:
 A aa;
 static A* hh = new A();
 
+// Still referenced from a global when Close runs: reported as "REACHABLE".
+int* g_stillReachable = nullptr;
+
+// Tracked blocks referenced only from a std::allocator buffer: reported as "REACHABLE", not as leaks.
+std::vector<int*> g_heldByStdVector;
+
+// A global container filled between Init and Close, released after Close when the globals are destroyed.
+mlt::ContainerStats g_trackedNumbersStats("global vector<int>", __LINE__);
+std::vector<int, mlt::TrackingAllocator<int>> g_trackedNumbers{ mlt::TrackingAllocator<int>(&g_trackedNumbersStats) };
+
+struct Node
+{
+    Node* m_next;
+};
+
 void testFn1()
 {
     for (int i = 0; i < 100000; i++)
@@ -34,7 +55,28 @@ void testFn1()
 
 int main(int argc, const char* argv[])
 {
-	mlt::Init(true);
+	mlt::Init(true, 256, true);
+    mlt::EnableProfiling(true);
+
+    g_stillReachable = new int(0);
+
+    for (int i = 0; i < 3; i++)
+    {
+        g_heldByStdVector.push_back(new int(i));
+    }
+
+    // Nothing points to the head of this list, so the head is reported as "LEAK" and
+    // the node it owns as "INDIRECT LEAK".
+    Node* leakedList = new Node();
+    leakedList->m_next = new Node();
+    leakedList->m_next->m_next = nullptr;
+    leakedList = nullptr;
+
+    // A leaked cycle: one node is reported as "LEAK", the other as "INDIRECT LEAK".
+    Node* leakedCycle = new Node();
+    leakedCycle->m_next = new Node();
+    leakedCycle->m_next->m_next = leakedCycle;
+    leakedCycle = nullptr;
 	
     int* pointerToTest = new int(0);
 
@@ -51,6 +93,37 @@ int main(int argc, const char* argv[])
 
     mlt::CheckHeapCorruption();
 
+    {
+        // Container allocations are tracked (and counted per container) through TrackingAllocator.
+        mlt::ContainerStats vectorStats("vector<int>", __LINE__);
+        std::vector<int, mlt::TrackingAllocator<int>> numbers{ mlt::TrackingAllocator<int>(&vectorStats) };
+        for (int i = 0; i < 1000; i++)
+        {
+            numbers.push_back(i);
+        }
+
+        typedef std::basic_string<char, std::char_traits<char>, mlt::TrackingAllocator<char>> TrackedString;
+        typedef std::pair<const int, TrackedString> MapValue;
+        mlt::ContainerStats mapStats("unordered_map<int, string>", __LINE__, 4096);
+        std::unordered_map<int, TrackedString, std::hash<int>, std::equal_to<int>, mlt::TrackingAllocator<MapValue>> names(
+            16, std::hash<int>(), std::equal_to<int>(), mlt::TrackingAllocator<MapValue>(&mapStats));
+        for (int i = 0; i < 100; i++)
+        {
+            names.emplace(i, TrackedString("a string long enough to skip the small string buffer", mlt::TrackingAllocator<char>(&mapStats)));
+        }
+
+        // Assignment keeps the destination's allocator: g_trackedNumbers stays on its own stats,
+        // which outlive vectorStats.
+        g_trackedNumbers = numbers;
+
+        mlt::PrintContainerStats();
+    }
+
+    for (int i = 0; i < 100; i++)
+    {
+        g_trackedNumbers.push_back(i);
+    }
+
     std::vector<std::thread> threads;
     for (int i = 0; i < 50; i++)
     {
@@ -62,7 +135,42 @@ int main(int argc, const char* argv[])
         thread.join();
     }
 
+    int result = 0;
+    {
+        mlt::LeakSummary before = mlt::ScanForLeaks(false);
+
+        // Memory held only on the stack of another live thread is reported as "REACHABLE".
+        std::atomic<bool> allocated(false);
+        std::atomic<bool> scanned(false);
+        std::thread holder([&allocated, &scanned]()
+        {
+            int* volatile held = new int(0);
+            allocated = true;
+            while (!scanned)
+            {
+                std::this_thread::yield();
+            }
+            delete held;
+        });
+
+        while (!allocated)
+        {
+            std::this_thread::yield();
+        }
+        mlt::LeakSummary during = mlt::ScanForLeaks();
+        scanned = true;
+        holder.join();
+
+        // The leaked list and the leaked cycle: 2 direct + 2 indirect leaks; the block held on the other stack is reachable.
+        if (during.m_unreachableCount != 2 || during.m_indirectCount != 2 || during.m_reachableCount != before.m_reachableCount + 1)
+        {
+            printf("[test] FAILED: %d unreachable (expected 2), %d indirect (expected 2), %d reachable (expected %d).\n",
+                during.m_unreachableCount, during.m_indirectCount, during.m_reachableCount, before.m_reachableCount + 1);
+            result = 1;
+        }
+    }
+
     mlt::Close();
-	return 0;
+	return result;
 }
 